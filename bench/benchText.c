@@ -0,0 +1,144 @@
+/** Benchmark for parallel glyph rasterization
+ * Draws a full page of text one glyph at a time, then with the render pool,
+ * checks the display ram matches bit for bit and reports the speedup.
+ * After a warm up redraw, no redraw should allocate from the heap, so it fails if any did,
+ * and reports how much of each arena was used, for sizing them.
+ * Only the display ram is touched, so this runs without the display attached.
+ *
+ * Usage: bin/bench [font.ttf] [fontsize] [iterations] [threads]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <string.h>
+#include <locale.h>
+#include <time.h>
+#include <wchar.h>
+
+#include "stb_truetype.h"
+#include "arena.h"
+#include "eInkTools.h"
+#include "fontTools.h"
+#include "renderPool.h"
+#include "log.h"
+
+#define PAGE_TEXT "吾輩は猫である。名前はまだ無い。どこで生れたかとんと見当がつかぬ。😁"
+#define MAX_PAGE_GLYPHS 400
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Lays out PAGE_TEXT down the whole screen, over and over. Each line is wrapped at HEIGHT and the
+// next carries on from the same character, so every glyph rasterized is on screen and compared.
+static int layout_page(font_chain_t* chain, int fontsize, glyph_pos_t* glyphs) {
+    wchar_t text[100];
+    int size = decode_string(PAGE_TEXT, text, 100);
+    int count = 0, next = 0;
+    for (int x = WIDTH - fontsize; x >= 0 && count < MAX_PAGE_GLYPHS; x -= fontsize) {
+        int y = 0;
+        while (count < MAX_PAGE_GLYPHS) {
+            // One character at a time, so the line can be broken before any of them
+            char character[MB_LEN_MAX + 1];
+            mbstate_t state;
+            memset(&state, 0, sizeof(mbstate_t));
+            size_t length = wcrtomb(character, text[next % size], &state);
+            character[length] = '\0';
+            glyph_pos_t glyph;
+            if (font_chain_layout(chain, fontsize, x, y, character, &glyph, 1) == 0) {
+                next++;
+                continue;
+            }
+
+            float scale = stbtt_ScaleForPixelHeight(glyph.font, fontsize);
+            int ix0, iy0, ix1, iy1, advanceWidth, leftSideBearing;
+            stbtt_GetGlyphBitmapBox(glyph.font, glyph.glyph, scale, scale, &ix0, &iy0, &ix1, &iy1);
+            // Glyphs run along y, so the bitmap's width is along y. One too wide for any line is placed anyway.
+            if (y + ix1 > HEIGHT && y > 0) {
+                break;
+            }
+            stbtt_GetGlyphHMetrics(glyph.font, glyph.glyph, &advanceWidth, &leftSideBearing);
+            glyphs[count++] = glyph;
+            y += (int)(advanceWidth * scale);
+            next++;
+        }
+    }
+    return count;
+}
+
+int main(int argc, char** argv) {
+    char* font_path = argc > 1 ? argv[1] : UNIFONT;
+    int fontsize = argc > 2 ? atoi(argv[2]) : 32;
+    int iterations = argc > 3 ? atoi(argv[3]) : 20;
+    int threads = argc > 4 ? atoi(argv[4]) : RENDER_THREADS;
+
+    setlocale(LC_ALL, "");
+    log_set_level(LOG_WARN);
+
+    stbtt_fontinfo* font = init_font(font_path, fontsize);
+    font_chain_t chain;
+    font_chain_init(&chain);
+    font_chain_add(&chain, font);
+
+    glyph_pos_t glyphs[MAX_PAGE_GLYPHS];
+    int count = layout_page(&chain, fontsize, glyphs);
+    printf("%d glyphs per page at %dpx, %d iterations\n", count, fontsize, iterations);
+
+    render_pool_t pool;
+    render_pool_init(&pool, threads);
+
+    // Warm up, so anything allocated once is not counted against the steady state
+    int width, height;
+    clear_display();
+    for (int i = 0; i < count; i++) {
+        write_glyph(glyphs[i].font, fontsize, glyphs[i].x, glyphs[i].y, &width, &height, glyphs[i].glyph);
+    }
+    clear_display();
+    render_pool_write_glyphs(&pool, glyphs, count, fontsize);
+    unsigned long heap_allocs = arena_heap_allocs();
+
+    // One glyph at a time on this thread
+    double start = now();
+    for (int n = 0; n < iterations; n++) {
+        clear_display();
+        for (int i = 0; i < count; i++) {
+            write_glyph(glyphs[i].font, fontsize, glyphs[i].x, glyphs[i].y, &width, &height, glyphs[i].glyph);
+        }
+    }
+    double serial = now() - start;
+    static uint8_t expected[HEIGHT * ROW_BYTES];
+    memcpy(expected, get_framebuffer(), sizeof(expected));
+
+    start = now();
+    for (int n = 0; n < iterations; n++) {
+        clear_display();
+        render_pool_write_glyphs(&pool, glyphs, count, fontsize);
+    }
+    double parallel = now() - start;
+    heap_allocs = arena_heap_allocs() - heap_allocs;
+
+    size_t scratch = 0, output = 0;
+    for (int i = 0; i < pool.threads; i++) {
+        scratch = pool.workers[i].scratch.high_water > scratch ? pool.workers[i].scratch.high_water : scratch;
+        output = pool.workers[i].output.high_water > output ? pool.workers[i].output.high_water : output;
+    }
+    render_pool_free(&pool);
+
+    int identical = memcmp(expected, get_framebuffer(), sizeof(expected)) == 0;
+    printf("serial:   %8.2f ms per page\n", serial * 1000 / iterations);
+    printf("parallel: %8.2f ms per page (%d threads)\n", parallel * 1000 / iterations, threads);
+    printf("speedup:  %8.2fx\n", serial / parallel);
+    printf("output:   %s\n", identical ? "identical" : "DIFFERENT");
+    printf("heap:     %lu allocations in %d redraws%s\n", heap_allocs, 2 * iterations, heap_allocs ? " - arena too small" : "");
+    printf("arenas:   glyph %zu of %zu, thread scratch %zu of %zu, thread output %zu of %zu bytes at most\n",
+           get_glyph_arena()->high_water, get_glyph_arena()->size, scratch, (size_t)GLYPH_ARENA_SIZE,
+           output, (size_t)RENDER_OUTPUT_ARENA_SIZE);
+
+    font_chain_free(&chain);
+    free(font->data);
+    free(font);
+    return identical && heap_allocs == 0 ? 0 : 1;
+}
@@ -0,0 +1,44 @@
+/**Bump allocator for scratch memory
+ * Allocations are carved from one block and all released at once by arena_reset,
+ * so rendering in a loop does not touch the heap once the arena is set up.
+ */
+
+#ifndef ARENA
+#define ARENA
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Default size of the arena stb_truetype rasterizes glyphs in. Override with -DGLYPH_ARENA_SIZE=...
+// A 32px CJK glyph needs around 20KB, so this leaves room for much larger sizes.
+#ifndef GLYPH_ARENA_SIZE
+#define GLYPH_ARENA_SIZE (256 * 1024)
+#endif
+
+typedef struct {
+    uint8_t* base;
+    size_t size;
+    size_t used;
+    size_t high_water; // most ever used between resets, for sizing the arena
+} arena_t;
+
+// Allocates the arena's block. This is the only heap allocation the arena makes while it fits.
+int arena_init(arena_t* arena, size_t size);
+
+// Returns size bytes from the arena. If the arena is NULL or full, falls back to malloc,
+// which is counted by arena_heap_allocs.
+void* arena_alloc(arena_t* arena, size_t size);
+
+// Frees memory from arena_alloc. Memory inside the arena is only released by arena_reset.
+void arena_free(arena_t* arena, void* ptr);
+
+// Releases everything allocated from the arena
+int arena_reset(arena_t* arena);
+
+// Frees the arena's block, logging its high water mark
+int arena_destroy(arena_t* arena);
+
+// Number of arena_alloc calls that had to use malloc. Should not grow while redrawing.
+unsigned long arena_heap_allocs(void);
+
+#endif // ARENA
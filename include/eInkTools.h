@@ -5,7 +5,11 @@
 #ifndef EINKTOOLS
 #define EINKTOOLS
 
+#include <stddef.h>
 #include <stdint.h>
+#include <wchar.h>
+
+#include "arena.h"
 
 
 // Font paths
@@ -19,6 +23,15 @@
 #define WIDTH 122 // in pixels
 #define WHITE 1
 #define BLACK 0
+#define ROW_BYTES ((WIDTH + 8) / 8) // bytes per row of display ram
+
+// A rectangle of pixels, in the same x y coords as write_pixel
+typedef struct {
+    int x;
+    int y;
+    int width;
+    int height;
+} region_t;
 
 
 // Initialise the display
@@ -35,6 +48,10 @@ int write_data(uint8_t data);
 // Refreshes the display, writing any data in RAM to the pixels
 int activate_display();
 
+// Sends only the given regions of display ram to the display, then does a partial refresh.
+// x is rounded out to whole bytes, as the display ram is addressed 8 pixels at a time.
+int activate_display_regions(region_t* regions, int count);
+
 // Clears the display
 int clear_display();
 
@@ -45,6 +62,14 @@ int pattern_display();
 // The display should be left in sleep mode when not in use
 int sleep_display();
 
+// Sets up the arena fonts rasterize glyphs in, so drawing text makes no heap allocations.
+// init_font calls this with GLYPH_ARENA_SIZE if it has not been called already.
+int init_glyph_arena(size_t size);
+
+// The glyph arena, e.g. to read its high water mark when sizing it
+arena_t* get_glyph_arena();
+
+// Loads a .ttf font. Its glyphs are rasterized in the glyph arena.
 stbtt_fontinfo* init_font(char* font, int fontsize);
 
 // Writes a character to the display ram with the specified font, fontsize, and x y coords.
@@ -52,11 +77,38 @@ stbtt_fontinfo* init_font(char* font, int fontsize);
 // Currently no support for .ttc font file collections.
 int write_char(stbtt_fontinfo* fontInfo, int fontsize, int x, int y, int *width, int *height, int character);
 
+// As write_char, but with a glyph index already looked up in the font, which skips the cmap search.
+int write_glyph(stbtt_fontinfo* fontInfo, int fontsize, int x, int y, int *width, int *height, int glyph);
+
+// Writes a rasterized glyph to the display ram. Pixels above half intensity are BLACK.
+// x y is the top left corner of the bitmap, rows of the bitmap run towards smaller x.
+int write_bitmap(unsigned char* bitmap, int width, int height, int x, int y);
+
+// Decodes a multibyte string in the current locale to at most max wide characters. Returns the count.
+int decode_string(char* string, wchar_t* dst, int max);
+
 int write_string(stbtt_fontinfo* fontInfo, int fontsize, int x, int y, char*string);
 
 // Writes a pixel to the display ram at the coords
+// Pixels outside the screen or the current clip are ignored and return 1
 int write_pixel(int colour, int x, int y);
 
+// The display ram, HEIGHT rows of ROW_BYTES, 1 bit per pixel with 1 for WHITE
+uint8_t* get_framebuffer();
+
+// Draw into, and send to the display from, another HEIGHT * ROW_BYTES buffer such as shared memory.
+// NULL goes back to the built in display ram.
+int set_framebuffer(uint8_t* framebuffer);
+
+// Restricts write_pixel to a region of the screen. NULL clips to the whole screen.
+int set_clip(region_t* region);
+
+// Fills a region of the display ram with a colour
+int fill_region(int colour, region_t* region);
+
+// Writes the overlap of a and b to out. Returns 0 if they do not overlap.
+int intersect_region(region_t* a, region_t* b, region_t* out);
+
 // Clear the screen and put to sleep for storage/unplugging the device
 int cleanup();
 
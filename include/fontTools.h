@@ -0,0 +1,58 @@
+/**Font fallback chains for the e-Paper display
+ * A chain is a list of fonts in order of preference, e.g. Monaco -> Unifont -> an emoji font.
+ * When a font is added, its cmap is read once into a coverage index, so finding
+ * the font and glyph for a codepoint is a table lookup rather than a cmap search per font.
+ */
+
+#ifndef FONT_TOOLS
+#define FONT_TOOLS
+
+#include <stdint.h>
+
+#include "stb_truetype.h"
+
+#define FONT_CHAIN_MAX 8
+#define CODEPOINT_MAX 0x110000
+
+// The index is split into pages of 256 codepoints, only allocated if some font covers them
+#define COVERAGE_PAGE_BITS 8
+#define COVERAGE_PAGE_SIZE (1 << COVERAGE_PAGE_BITS)
+#define COVERAGE_PAGES (CODEPOINT_MAX >> COVERAGE_PAGE_BITS)
+
+// A glyph placed by font_chain_layout, at the x y write_glyph takes
+typedef struct {
+    stbtt_fontinfo* font;
+    int glyph;
+    int x;
+    int y;
+} glyph_pos_t;
+
+typedef struct {
+    stbtt_fontinfo* fonts[FONT_CHAIN_MAX];
+    int count;
+    // Each entry is (font index + 1) << 16 | glyph index, or 0 if no font has the codepoint
+    uint32_t* pages[COVERAGE_PAGES];
+} font_chain_t;
+
+// Empties a chain
+int font_chain_init(font_chain_t* chain);
+
+// Adds a font to the end of the chain, and indexes the codepoints it has that earlier fonts do not
+int font_chain_add(font_chain_t* chain, stbtt_fontinfo* font);
+
+// Finds the first font in the chain with the codepoint, and its glyph index in that font.
+// Returns 1 if no font has it, with the first font's .notdef glyph.
+// Returns -1 with a NULL font if the chain is empty, in which case the glyph should be skipped.
+int font_chain_lookup(font_chain_t* chain, int codepoint, stbtt_fontinfo** font, int* glyph);
+
+// Places the glyphs of a string where font_chain_write_string would draw them, without drawing.
+// Returns the number of glyphs, at most max. Spaces take no glyph.
+int font_chain_layout(font_chain_t* chain, int fontsize, int x, int y, char* string, glyph_pos_t* glyphs, int max);
+
+// Writes a string, taking each character from the first font in the chain that has it
+int font_chain_write_string(font_chain_t* chain, int fontsize, int x, int y, char* string);
+
+// Frees the coverage index. The fonts themselves are left to the caller.
+int font_chain_free(font_chain_t* chain);
+
+#endif // FONT_TOOLS
@@ -0,0 +1,37 @@
+/**Streaming frames to the e-Paper display
+ * Reads a continuous sequence of frames from a file descriptor (stdin, a pipe or a FIFO)
+ * and shows each with a partial refresh. If frames arrive faster than the panel can refresh,
+ * the ones waiting are skipped so the newest is always shown next.
+ *
+ * Frames are either PBM (P4) images, WIDTH x HEIGHT or HEIGHT x WIDTH (landscape),
+ * or raw display ram: HEIGHT rows of ROW_BYTES, 1 bit per pixel with 1 for WHITE.
+ */
+
+#ifndef FRAME_STREAM
+#define FRAME_STREAM
+
+#include <stdint.h>
+
+#include "stb_truetype.h"
+#include "eInkTools.h"
+
+#define STREAM_FULL_REFRESH 50 // partial refreshes between full refreshes, to clear ghosting
+#define STREAM_BUFFER 64 // bytes read ahead for headers. Frame data is read straight into a frame slot.
+
+#define LANDSCAPE_ROW_BYTES ((HEIGHT + 7) / 8) // bytes per row of a HEIGHT x WIDTH PBM
+
+typedef enum {
+    FRAME_PBM,
+    FRAME_RAW
+} frame_format_t;
+
+// Shows frames from fd until it reaches end of file. A malformed frame is skipped, and the stream
+// picks up again at the next P4. A frame cut off by the end of file is dropped, and the whole frame before it shown.
+// Returns 1 if any frame was malformed.
+int stream_frames(int fd, frame_format_t format);
+
+// Shows frames from a path, or stdin if the path is "-".
+// A FIFO is reopened at end of file, to wait for the next writer.
+int stream_path(char* path, frame_format_t format);
+
+#endif // FRAME_STREAM
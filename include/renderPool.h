@@ -0,0 +1,76 @@
+/**Thread pool for rasterizing glyphs in parallel
+ * The glyphs of a laid out string, or a whole frame, are shared between the threads, each
+ * rasterizing into its own arenas. The main thread then draws them into display ram in order,
+ * so the result is bit for bit the same as drawing them one at a time with write_glyph.
+ */
+
+#ifndef RENDER_POOL
+#define RENDER_POOL
+
+#include <stddef.h>
+#include <pthread.h>
+
+#include "stb_truetype.h"
+#include "arena.h"
+#include "fontTools.h"
+
+#define RENDER_THREADS 4 // The pi zero 2W has 4 cores
+#define RENDER_MAX_THREADS 8
+#define RENDER_MAX_GLYPHS 256 // per call
+
+// Size of each thread's arena for the rasterized glyphs of one call
+#ifndef RENDER_OUTPUT_ARENA_SIZE
+#define RENDER_OUTPUT_ARENA_SIZE (256 * 1024)
+#endif
+
+typedef struct render_pool render_pool_t;
+
+typedef struct {
+    render_pool_t* pool;
+    pthread_t thread;
+    arena_t scratch; // stb_truetype's working memory, reset after every glyph
+    arena_t output;  // rasterized glyphs, reset once they are drawn
+} render_worker_t;
+
+typedef struct {
+    unsigned char* bitmap;
+    int width;
+    int height;
+    int xoff;
+    int yoff;
+    int worker;
+} render_result_t;
+
+struct render_pool {
+    render_worker_t workers[RENDER_MAX_THREADS];
+    int threads;
+
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    unsigned generation; // bumped for each batch of glyphs
+    int running;         // workers still on the current batch
+    int stop;
+
+    // The current batch
+    glyph_pos_t* glyphs;
+    int count;
+    int fontsize;
+    int next; // next glyph to be taken by a worker
+    render_result_t results[RENDER_MAX_GLYPHS];
+};
+
+// Starts the threads. threads is capped at RENDER_MAX_THREADS.
+int render_pool_init(render_pool_t* pool, int threads);
+
+// Rasterizes glyphs in parallel, then writes them to the display ram in order.
+// Glyphs past RENDER_MAX_GLYPHS are drawn in further batches.
+int render_pool_write_glyphs(render_pool_t* pool, glyph_pos_t* glyphs, int count, int fontsize);
+
+// As font_chain_write_string, with the glyphs rasterized in parallel
+int render_pool_write_string(render_pool_t* pool, font_chain_t* chain, int fontsize, int x, int y, char* string);
+
+// Stops the threads and frees their arenas
+int render_pool_free(render_pool_t* pool);
+
+#endif // RENDER_POOL
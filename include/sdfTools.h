@@ -0,0 +1,59 @@
+/**Signed distance field text for the e-Paper display
+ * Each glyph's distance field is generated once, at SDF_SIZE, and cached. It is then drawn at
+ * any font size by sampling the field and thresholding straight to black and white pixels.
+ * Moving the threshold gives bold or thin text, and a band around it gives outlined text.
+ */
+
+#ifndef SDF_TOOLS
+#define SDF_TOOLS
+
+#include "stb_truetype.h"
+#include "fontTools.h"
+
+#define SDF_SIZE 64    // pixel height the fields are generated at
+#define SDF_PADDING 8  // pixels of field kept around each glyph, which limits how far weight can move the edge
+#define SDF_ONEDGE 128 // field value on the outline of the glyph
+#define SDF_DIST_SCALE ((float)SDF_ONEDGE / SDF_PADDING) // field value per pixel at SDF_SIZE
+
+#define SDF_CACHE_SIZE 512 // glyphs, must be a power of 2
+#define SDF_CACHE_PROBES 8
+
+typedef struct {
+    stbtt_fontinfo* font; // NULL if the entry is empty
+    int glyph;
+    unsigned char* sdf;
+    int width;
+    int height;
+    int xoff;
+    int yoff;
+} sdf_glyph_t;
+
+typedef struct {
+    sdf_glyph_t entries[SDF_CACHE_SIZE];
+    unsigned long hits;
+    unsigned long misses;
+} sdf_cache_t;
+
+// Empties a cache
+int sdf_cache_init(sdf_cache_t* cache);
+
+// How far, in pixels at fontsize, the edge can be moved before it runs off the field.
+// Just under SDF_PADDING * fontsize / SDF_SIZE, e.g. 1.9 at 16 pixels and 3.8 at 32.
+float sdf_max_edge(int fontsize);
+
+// Writes a glyph from its cached distance field, generating it if needed. Arguments are as write_glyph.
+// weight - pixels to grow the glyph by, so positive is bolder and negative thinner.
+// outline - if above 0, only a line this many pixels wide around the edge is drawn.
+// The field only reaches sdf_max_edge(fontsize) pixels out from the edge, so weight is limited to
+// that either way, and weight + outline / 2 to at most that. Larger values are clamped.
+int sdf_write_glyph(sdf_cache_t* cache, stbtt_fontinfo* fontInfo, int fontsize, int x, int y, int *width, int *height,
+                    int glyph, float weight, float outline);
+
+// As font_chain_write_string, drawn from distance fields
+int sdf_write_string(sdf_cache_t* cache, font_chain_t* chain, int fontsize, int x, int y, char* string,
+                     float weight, float outline);
+
+// Frees the cached fields
+int sdf_cache_free(sdf_cache_t* cache);
+
+#endif // SDF_TOOLS
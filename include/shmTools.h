@@ -0,0 +1,53 @@
+/**Shared memory framebuffer for the e-Paper display
+ * The refresh side creates a framebuffer in /dev/shm, in the layout of display ram,
+ * with a small header holding a sequence number and a dirty region.
+ * Other processes open it, draw straight into the pixels (set_framebuffer lets the
+ * drawing functions do this), then commit the region they changed. A commit bumps the
+ * sequence number, which doubles as a futex to wake the refresh side.
+ * Pixels are not copied or locked, so drawing during a refresh may show part drawn.
+ */
+
+#ifndef SHM_TOOLS
+#define SHM_TOOLS
+
+#include <stdint.h>
+
+#include "stb_truetype.h"
+#include "eInkTools.h"
+
+#define SHM_FB_NAME "/eink-framebuffer" // appears as /dev/shm/eink-framebuffer
+#define SHM_FB_MAGIC 0x42464B45 // "EKFB"
+#define SHM_FB_VERSION 1
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t row_bytes;
+    uint32_t sequence; // bumped by every commit, and waited on as a futex
+    uint64_t dirty;    // everything committed since the refresh side last took it, packed by pack_dirty, 0 if nothing
+    uint8_t pixels[HEIGHT][ROW_BYTES] __attribute__((aligned(64))); // 1 bit per pixel, 1 for WHITE
+} shm_framebuffer_t;
+
+// Creates the shared framebuffer, or reuses an existing one, cleared to white. For the refresh side.
+shm_framebuffer_t* shm_fb_create(const char* name);
+
+// Opens a framebuffer made by shm_fb_create. For producers. Returns NULL if it is missing or does not match.
+shm_framebuffer_t* shm_fb_open(const char* name);
+
+// Marks a region as changed and wakes the refresh side. NULL marks the whole screen.
+int shm_fb_commit(shm_framebuffer_t* fb, region_t* region);
+
+// Waits for a commit after *sequence, then takes the dirty region and updates *sequence.
+// timeout_ms below 0 waits forever.
+// Returns 0 on a commit (dirty may be empty if an earlier wait took it), 1 on timeout, -1 if interrupted by a signal.
+int shm_fb_wait(shm_framebuffer_t* fb, uint32_t* sequence, region_t* dirty, int timeout_ms);
+
+// Unmaps the framebuffer
+int shm_fb_close(shm_framebuffer_t* fb);
+
+// Removes the framebuffer's name. Processes that have it open keep their mapping.
+int shm_fb_unlink(const char* name);
+
+#endif // SHM_TOOLS
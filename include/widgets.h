@@ -0,0 +1,79 @@
+/**Retained widgets for the e-Paper display
+ * A scene holds fixed regions of the screen (text, rectangles, images).
+ * Changing a widget marks it dirty, and scene_render redraws only the dirty
+ * parts of the screen and reports them, so only those need to be sent to the display.
+ */
+
+#ifndef WIDGETS
+#define WIDGETS
+
+#include <stdint.h>
+
+#include "stb_truetype.h"
+#include "eInkTools.h"
+
+#define SCENE_MAX_WIDGETS 32
+#define WIDGET_TEXT_MAX 64 // bytes, including the terminator
+
+typedef enum {
+    WIDGET_TEXT,
+    WIDGET_RECT,
+    WIDGET_IMAGE
+} widget_type_t;
+
+typedef struct {
+    widget_type_t type;
+    region_t bounds;  // Where the widget is drawn. Nothing is drawn outside it.
+    region_t drawn;   // Bounds when last rendered, cleared if the widget moves or hides
+    int is_drawn;
+    int dirty;
+    int visible;
+    union {
+        struct {
+            stbtt_fontinfo* font;
+            int fontsize;
+            char string[WIDGET_TEXT_MAX];
+        } text;
+        struct {
+            int colour;
+            int filled;
+        } rect;
+        struct {
+            // 1 bit per pixel, rows along y, MSB first, 1 for WHITE - the same layout as display ram
+            const uint8_t* bitmap;
+        } image;
+    };
+} widget_t;
+
+typedef struct {
+    widget_t widgets[SCENE_MAX_WIDGETS]; // drawn in order, later widgets on top
+    int count;
+} scene_t;
+
+// Empties a scene
+int scene_init(scene_t* scene);
+
+// Add widgets to a scene. Each starts dirty. Returns NULL if the scene is full.
+// Text is drawn along y from the top left of the bounds, with the baseline set from the font's descent.
+// Text longer than WIDGET_TEXT_MAX - 1 bytes is cut at the last whole UTF-8 character that fits.
+widget_t* scene_add_text(scene_t* scene, region_t bounds, stbtt_fontinfo* font, int fontsize, const char* string);
+widget_t* scene_add_rect(scene_t* scene, region_t bounds, int colour, int filled);
+widget_t* scene_add_image(scene_t* scene, region_t bounds, const uint8_t* bitmap);
+
+// Change a widget. Each only marks the widget dirty if something actually changed,
+// except widget_set_image, as the bitmap may have been changed in place.
+// Each returns 1 without changing anything if the widget is not of the setter's type.
+int widget_set_text(widget_t* widget, const char* string);
+int widget_set_colour(widget_t* widget, int colour);
+int widget_set_image(widget_t* widget, const uint8_t* bitmap);
+int widget_set_bounds(widget_t* widget, region_t bounds);
+int widget_set_visible(widget_t* widget, int visible);
+
+// Redraws the dirty widgets into display ram. Their old bounds are cleared, and any
+// other widget overlapping the cleared area is redrawn inside it.
+// The changed regions are written to regions, and the count returned.
+// If there are more than max_regions, they are merged into one.
+// max_regions must be at least 1, otherwise nothing is redrawn and 0 is returned.
+int scene_render(scene_t* scene, region_t* regions, int max_regions);
+
+#endif // WIDGETS
@@ -0,0 +1,74 @@
+// Bump allocator used for stb_truetype's scratch memory
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "arena.h"
+#include "log.h"
+
+#define ARENA_ALIGN 16
+
+static unsigned long heap_allocs = 0;
+
+int arena_init(arena_t* arena, size_t size) {
+    arena->base = malloc(size);
+    if (arena->base == NULL) {
+        log_msg(LOG_ERROR, "Failed to allocate %zu byte arena", size);
+        exit(EXIT_FAILURE);
+    }
+    arena->size = size;
+    arena->used = 0;
+    arena->high_water = 0;
+    return 0;
+}
+
+void* arena_alloc(arena_t* arena, size_t size) {
+    if (arena != NULL && arena->base != NULL) {
+        size_t aligned = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+        if (aligned <= arena->size - arena->used) {
+            void* ptr = arena->base + arena->used;
+            arena->used += aligned;
+            if (arena->used > arena->high_water) {
+                arena->high_water = arena->used;
+            }
+            return ptr;
+        }
+        log_msg(LOG_WARN, "Arena full (%zu of %zu bytes), taking %zu bytes from the heap",
+                arena->used, arena->size, size);
+    }
+    // Arenas are per thread, but the count is shared
+    __atomic_fetch_add(&heap_allocs, 1, __ATOMIC_RELAXED);
+    return malloc(size);
+}
+
+void arena_free(arena_t* arena, void* ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    if (arena != NULL && arena->base != NULL &&
+        (uint8_t*)ptr >= arena->base && (uint8_t*)ptr < arena->base + arena->size) {
+        return;
+    }
+    free(ptr);
+}
+
+int arena_reset(arena_t* arena) {
+    if (arena != NULL) {
+        arena->used = 0;
+    }
+    return 0;
+}
+
+int arena_destroy(arena_t* arena) {
+    log_msg(LOG_INFO, "Arena used at most %zu of %zu bytes", arena->high_water, arena->size);
+    free(arena->base);
+    arena->base = NULL;
+    arena->size = 0;
+    arena->used = 0;
+    return 0;
+}
+
+unsigned long arena_heap_allocs(void) {
+    return __atomic_load_n(&heap_allocs, __ATOMIC_RELAXED);
+}
@@ -1,23 +1,107 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <wchar.h>
 #include <locale.h>
+#include <signal.h>
 
 #include "../include/stb_truetype.h"
 #include "../include/eInkTools.h"
+#include "../include/fontTools.h"
+#include "../include/frameStream.h"
+#include "../include/shmTools.h"
+
+static volatile sig_atomic_t running = 1;
+
+static void stop(int signal) {
+    running = 0;
+}
+
+// Shows frames piped in, until the stream ends
+// Usage: test --stream [--raw] [path]  - path defaults to stdin
+static int run_stream(int argc, char** argv) {
+    frame_format_t format = FRAME_PBM;
+    char* path = "-";
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--raw") == 0) {
+            format = FRAME_RAW;
+        }
+        else {
+            path = argv[i];
+        }
+    }
+    init_display();
+    clear_display();
+    activate_display();
+    int ret = stream_path(path, format);
+    sleep_display();
+    return ret;
+}
+
+// Shows whatever other processes draw into the shared framebuffer, until interrupted
+// Usage: test --shm [name]  - name defaults to SHM_FB_NAME
+static int run_shm(int argc, char** argv) {
+    const char* name = argc > 2 ? argv[2] : SHM_FB_NAME;
+    // No SA_RESTART, so the wait returns on ctrl-c
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    init_display();
+    shm_framebuffer_t* fb = shm_fb_create(name);
+    set_framebuffer(&fb->pixels[0][0]);
+    activate_display();
+
+    uint32_t sequence = __atomic_load_n(&fb->sequence, __ATOMIC_ACQUIRE);
+    region_t dirty;
+    int shown = 0;
+    while (running) {
+        if (shm_fb_wait(fb, &sequence, &dirty, -1) != 0 || dirty.width == 0 || dirty.height == 0) {
+            continue;
+        }
+        // Full refresh now and then to clear ghosting, as stream_frames does
+        if (shown % STREAM_FULL_REFRESH == STREAM_FULL_REFRESH - 1) {
+            activate_display();
+        }
+        else {
+            activate_display_regions(&dirty, 1);
+        }
+        shown++;
+    }
+
+    sleep_display();
+    set_framebuffer(NULL);
+    shm_fb_close(fb);
+    shm_fb_unlink(name);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "--stream") == 0) {
+        return run_stream(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "--shm") == 0) {
+        return run_shm(argc, argv);
+    }
 
-int main(void) {
     init_display();
     clear_display();
     setlocale(LC_ALL, "");
 
     //display_grid(8);
     printf("initialising font\n");
+    stbtt_fontinfo* monaco = init_font(MONACO, 32);
     stbtt_fontinfo* fontinfo = init_font(UNIFONT, 32);
+    font_chain_t chain;
+    font_chain_init(&chain);
+    font_chain_add(&chain, monaco);
+    font_chain_add(&chain, fontinfo);
     printf("Writing string\n");
-    write_string(fontinfo, 30, 64, 16, "ヤッホー、ヒナ");
-    write_string(fontinfo, 32, 32, 16, "直した！😁");
+    font_chain_write_string(&chain, 30, 64, 16, "ヤッホー、ヒナ");
+    font_chain_write_string(&chain, 32, 32, 16, "直した！😁");
     printf("String written\n");
 //    int width, height;
 //    write_char(UNIFONT, 32, 32, 32, &width, &height, 0x306F);
@@ -29,6 +113,9 @@ int main(void) {
     activate_display();
 
     sleep_display();
+    font_chain_free(&chain);
+    free(monaco->data);
+    free(monaco);
     free(fontinfo->data);
     free(fontinfo);
     return 0;
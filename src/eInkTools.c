@@ -15,12 +15,23 @@
 
 
 #include "stb_truetype.h"
+#include "arena.h"
 #include "eInkTools.h"
 #include "gpioTools.h"
 #include "spiTools.h"
 #include "log.h"
 
-static uint8_t display[HEIGHT][(WIDTH + 8) / 8];
+static uint8_t display_storage[HEIGHT][ROW_BYTES];
+static uint8_t (*display)[ROW_BYTES] = display_storage; // may be moved to shared memory by set_framebuffer
+// Copy of what was last sent to the display's new image RAM. The same bytes go to the previous image RAM
+// after the refresh, even if display ram (which may be shared memory) is drawn into during the refresh.
+static uint8_t sent[HEIGHT][ROW_BYTES];
+static region_t clip = {0, 0, WIDTH, HEIGHT};
+static arena_t glyph_arena;
+
+static int set_ram_window(int x_start, int x_end, int y_start, int y_end);
+static int write_ram_region(uint8_t ram, region_t* region);
+static int snapshot_region(region_t* region);
 
 // Writes a byte as a command to the display
 int write_command(uint8_t command) {
@@ -101,10 +112,12 @@ int init_display() {
 
 int activate_display() {
     log_msg(LOG_INFO, "Activating display");
+    region_t screen = {0, 0, WIDTH, HEIGHT};
+    snapshot_region(&screen);
     write_command(0x24);
     for (int j = 0; j < HEIGHT; j++) {
-        for (int i = 0; i < (WIDTH + 8) / 8; i++) {
-            write_data(display[j][i]);
+        for (int i = 0; i < ROW_BYTES; i++) {
+            write_data(sent[j][i]);
         }
     }
 
@@ -113,17 +126,101 @@ int activate_display() {
     // display with display mode 1
     // disable analog
     // disable OSC
-    //write_data(0xF7);
+    // Set explicitly, as activate_display_regions leaves it on partial update
+    write_command(0x22); // Display update control 2
+    write_data(0xF7);
+
+    write_command(0x20); // Activate display update sequence
+    wait_busy();
+
+    // Match the previous image to the panel, so partial updates after this start from it
+    write_ram_region(0x26, &screen);
+    set_ram_window(0, (WIDTH - 1) >> 3, 0, HEIGHT - 1);
+    return 0;
+}
+
+// Sets the RAM window and moves the address counter to its start.
+// x is in bytes, y is in gate lines.
+static int set_ram_window(int x_start, int x_end, int y_start, int y_end) {
+    write_command(0x44); // X RAM
+    write_data(x_start & 0xFF);
+    write_data(x_end & 0xFF);
+
+    write_command(0x45); // Y RAM
+    write_data(y_start & 0xFF);
+    write_data((y_start >> 8) & 0xFF);
+    write_data(y_end & 0xFF);
+    write_data((y_end >> 8) & 0xFF);
+
+    write_command(0x4E); // Initial X
+    write_data(x_start & 0xFF);
+
+    write_command(0x4F); // Initial Y
+    write_data(y_start & 0xFF);
+    write_data((y_start >> 8) & 0xFF);
+    return 0;
+}
+
+// Copies the bytes of display ram covering the region to sent
+static int snapshot_region(region_t* region) {
+    int x_start = region->x / 8;
+    int x_end = (region->x + region->width - 1) / 8;
+    for (int j = region->y; j < region->y + region->height; j++) {
+        memcpy(&sent[j][x_start], &display[j][x_start], x_end - x_start + 1);
+    }
+    return 0;
+}
+
+// Writes the bytes of sent covering the region to one of the display's RAMs
+// 0x24 holds the new image, 0x26 the previous image used for partial updates
+static int write_ram_region(uint8_t ram, region_t* region) {
+    int x_start = region->x / 8;
+    int x_end = (region->x + region->width - 1) / 8;
+    set_ram_window(x_start, x_end, region->y, region->y + region->height - 1);
+
+    write_command(ram);
+    set_data_command(DATA);
+    for (int j = region->y; j < region->y + region->height; j++) {
+        write_spi(&sent[j][x_start], x_end - x_start + 1);
+    }
+    return 0;
+}
+
+int activate_display_regions(region_t* regions, int count) {
+    log_msg(LOG_INFO, "Activating %d display regions", count);
+    region_t screen = {0, 0, WIDTH, HEIGHT};
+    region_t region;
+    for (int i = 0; i < count; i++) {
+        if (intersect_region(&regions[i], &screen, &region)) {
+            snapshot_region(&region);
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        if (intersect_region(&regions[i], &screen, &region)) {
+            write_ram_region(0x24, &region);
+        }
+    }
+    set_ram_window(0, (WIDTH - 1) >> 3, 0, HEIGHT - 1);
 
+    write_command(0x22); // Display update control 2
+    write_data(0xFF); // Display mode 2 - partial update
     write_command(0x20); // Activate display update sequence
     wait_busy();
+
+    // Bring the previous image up to date, so the next partial update only drives what changed
+    for (int i = 0; i < count; i++) {
+        if (intersect_region(&regions[i], &screen, &region)) {
+            write_ram_region(0x26, &region);
+        }
+    }
+    set_ram_window(0, (WIDTH - 1) >> 3, 0, HEIGHT - 1);
     return 0;
 }
 
 int clear_display() {
     log_msg(LOG_INFO, "Clearing display");
     for (int i = 0; i < HEIGHT; i++) {
-        for (int j = 0; j < (WIDTH + 8) / 8; j++) {
+        for (int j = 0; j < ROW_BYTES; j++) {
             display[i][j] = 0xFF;
         }
     }
@@ -134,7 +231,7 @@ int clear_display() {
 int pattern_display() {
     log_msg(LOG_INFO, "Patterning display");
     for (int i = 0; i < HEIGHT; i++) {
-        for (int j = 0; j < (WIDTH + 8 ) / 8; j++) {
+        for (int j = 0; j < ROW_BYTES; j++) {
             if ((i % 16 == 0) || ((i + 1) % 16 == 0)) {
                 display[i][j] = 0xFF;
             }
@@ -161,6 +258,18 @@ int cleanup() {
     return 0;
 }
 
+int init_glyph_arena(size_t size) {
+    if (glyph_arena.base != NULL) {
+        arena_destroy(&glyph_arena);
+    }
+    log_msg(LOG_INFO, "Glyph arena is %zu bytes", size);
+    return arena_init(&glyph_arena, size);
+}
+
+arena_t* get_glyph_arena() {
+    return &glyph_arena;
+}
+
 stbtt_fontinfo* init_font(char* font, int fontsize) {
     log_msg(LOG_INFO, "Initialising font");
     // Get font file and filesize
@@ -184,6 +293,11 @@ stbtt_fontinfo* init_font(char* font, int fontsize) {
         exit(EXIT_FAILURE);
     }
     
+    if (glyph_arena.base == NULL) {
+        init_glyph_arena(GLYPH_ARENA_SIZE);
+    }
+    fontInfo->userdata = &glyph_arena;
+
     stbtt_ScaleForPixelHeight(fontInfo, 32);
     //free(data);
     return fontInfo;
@@ -191,28 +305,41 @@ stbtt_fontinfo* init_font(char* font, int fontsize) {
 
 
 int write_char(stbtt_fontinfo *fontInfo, int fontsize, int x, int y, int *width, int *height, int character) {
+    return write_glyph(fontInfo, fontsize, x, y, width, height, stbtt_FindGlyphIndex(fontInfo, character));
+}
+
+
+int write_glyph(stbtt_fontinfo *fontInfo, int fontsize, int x, int y, int *width, int *height, int glyph) {
 
     float scale = stbtt_ScaleForPixelHeight(fontInfo, fontsize);
     int xoff, yoff;
     *width = 0;
     *height = 0;
-    unsigned char* bitmap = stbtt_GetCodepointBitmap(fontInfo, scale, scale, character, width, height, &xoff, &yoff);
-    x = x - yoff;
-    y = y + xoff;
+    unsigned char* bitmap = stbtt_GetGlyphBitmap(fontInfo, scale, scale, glyph, width, height, &xoff, &yoff);
+    write_bitmap(bitmap, *width, *height, x - yoff, y + xoff);
+    // The bitmap and everything used to rasterize it came from the arena - release it all
+    stbtt_FreeBitmap(bitmap, fontInfo->userdata);
+    arena_reset(fontInfo->userdata);
+
+    // Fill the width with the advance width of the character...
+    int leftSideBearing, advanceWidth;
+    stbtt_GetGlyphHMetrics(fontInfo, glyph, &advanceWidth, &leftSideBearing);
+    *width = (int)(advanceWidth * scale);
+    return 0;
+}
+
+
+int write_bitmap(unsigned char* bitmap, int width, int height, int x, int y) {
     // Convert the font byte map, to a bit map compatible with the e-ink display
     // i.e. an array of bytes whose bits correspond to active or inactive pixels
-    for (int j = 0; j < *height; j++) {
-        for (int i = 0; i < *width; i++) {
-            if (bitmap[j * *width + i] > (255 * 0.5)) {
+    for (int j = 0; j < height; j++) {
+        for (int i = 0; i < width; i++) {
+            if (bitmap[j * width + i] > (255 * 0.5)) {
                 write_pixel(BLACK, x - j, y + i);
             }
         }
 
     }
-    // Fill the width with the advance width of the character...
-    int leftSideBearing, advanceWidth;
-    stbtt_GetCodepointHMetrics(fontInfo, character, &advanceWidth, &leftSideBearing);
-    *width = (int)(advanceWidth * scale);
     return 0;
 }
 
@@ -224,7 +351,7 @@ int write_pixel(int colour, int x, int y) {
     int byteY = y;
     int bit_position = 7 - x % 8;
 
-    if (byteX > WIDTH || byteY > HEIGHT) {
+    if (x < clip.x || x >= clip.x + clip.width || y < clip.y || y >= clip.y + clip.height) {
         return 1;
     }
 
@@ -239,19 +366,64 @@ int write_pixel(int colour, int x, int y) {
     return 0;
 }
 
+uint8_t* get_framebuffer() {
+    return &display[0][0];
+}
+
+int set_framebuffer(uint8_t* framebuffer) {
+    if (framebuffer == NULL) {
+        display = display_storage;
+    }
+    else {
+        display = (uint8_t (*)[ROW_BYTES])framebuffer;
+    }
+    return 0;
+}
+
+int set_clip(region_t* region) {
+    region_t screen = {0, 0, WIDTH, HEIGHT};
+    if (region == NULL) {
+        clip = screen;
+        return 0;
+    }
+    if (intersect_region(region, &screen, &clip) == 0) {
+        // Nothing on screen - clip everything
+        clip.width = 0;
+        clip.height = 0;
+    }
+    return 0;
+}
+
+int fill_region(int colour, region_t* region) {
+    for (int j = region->y; j < region->y + region->height; j++) {
+        for (int i = region->x; i < region->x + region->width; i++) {
+            write_pixel(colour, i, j);
+        }
+    }
+    return 0;
+}
+
+int intersect_region(region_t* a, region_t* b, region_t* out) {
+    int x0 = a->x > b->x ? a->x : b->x;
+    int y0 = a->y > b->y ? a->y : b->y;
+    int x1 = a->x + a->width < b->x + b->width ? a->x + a->width : b->x + b->width;
+    int y1 = a->y + a->height < b->y + b->height ? a->y + a->height : b->y + b->height;
+    if (x1 <= x0 || y1 <= y0) {
+        return 0;
+    }
+    out->x = x0;
+    out->y = y0;
+    out->width = x1 - x0;
+    out->height = y1 - y0;
+    return 1;
+}
+
 int write_string(stbtt_fontinfo* fontInfo, int fontsize, int x, int y, char* string) {
 
     log_msg(LOG_INFO, "Writing string: %s", string);
-    const char* const_str = string;
     wchar_t dst[100];
-    mbstate_t state;
-    memset(&state, 0, sizeof(mbstate_t));
-    size_t size = mbsrtowcs(dst, &const_str, 100, &state);
-    if (size == (size_t)-1) {
-        perror("Error in mbsrtowcs read: ");
-        log_msg(LOG_ERROR, "Error in mbsrtowcs");
-        exit(EXIT_FAILURE);
-    }
+    int size = decode_string(string, dst, 100);
+    unsigned long heap_allocs = arena_heap_allocs();
     int width = 0, height = 0, length = 0;
     for(int i = 0; i < size; i++) {
         
@@ -267,10 +439,27 @@ int write_string(stbtt_fontinfo* fontInfo, int fontsize, int x, int y, char* str
         write_char(fontInfo, fontsize, x, y + length, &width, &height, dst[i]);
         length += width;
     }
+    if (arena_heap_allocs() != heap_allocs) {
+        log_msg(LOG_WARN, "%lu heap allocations while writing string", arena_heap_allocs() - heap_allocs);
+    }
     return 0;
 }
 
 
+int decode_string(char* string, wchar_t* dst, int max) {
+    const char* const_str = string;
+    mbstate_t state;
+    memset(&state, 0, sizeof(mbstate_t));
+    size_t size = mbsrtowcs(dst, &const_str, max, &state);
+    if (size == (size_t)-1) {
+        perror("Error in mbsrtowcs read: ");
+        log_msg(LOG_ERROR, "Error in mbsrtowcs");
+        exit(EXIT_FAILURE);
+    }
+    return (int)size;
+}
+
+
 int display_grid(int pixels_per_square) {
     
     for (int i = 0; i < WIDTH; i++) {
@@ -0,0 +1,192 @@
+// Font fallback chains with a precomputed codepoint coverage index
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "stb_truetype.h"
+#include "arena.h"
+#include "eInkTools.h"
+#include "fontTools.h"
+#include "log.h"
+
+// cmap values are big endian
+static uint16_t read_u16(const uint8_t* p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static uint32_t read_u32(const uint8_t* p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+// Records the glyph for a codepoint, unless an earlier font in the chain already has it
+static int index_codepoint(font_chain_t* chain, int font_index, int codepoint) {
+    if (codepoint < 0 || codepoint >= CODEPOINT_MAX) {
+        return 0;
+    }
+    uint32_t** page = &chain->pages[codepoint >> COVERAGE_PAGE_BITS];
+    uint32_t* entry = *page ? &(*page)[codepoint & (COVERAGE_PAGE_SIZE - 1)] : NULL;
+    if (entry != NULL && *entry != 0) {
+        return 0;
+    }
+    int glyph = stbtt_FindGlyphIndex(chain->fonts[font_index], codepoint);
+    if (glyph == 0) {
+        return 0;
+    }
+    if (*page == NULL) {
+        *page = calloc(COVERAGE_PAGE_SIZE, sizeof(uint32_t));
+        if (*page == NULL) {
+            log_msg(LOG_ERROR, "Failed to allocate coverage page");
+            exit(EXIT_FAILURE);
+        }
+        entry = &(*page)[codepoint & (COVERAGE_PAGE_SIZE - 1)];
+    }
+    *entry = (uint32_t)(font_index + 1) << 16 | (uint16_t)glyph;
+    return 1;
+}
+
+// Indexes every codepoint in a range that the font has
+static int index_range(font_chain_t* chain, int font_index, uint32_t start, uint32_t end) {
+    int count = 0;
+    if (end >= CODEPOINT_MAX) {
+        end = CODEPOINT_MAX - 1;
+    }
+    for (uint32_t codepoint = start; codepoint <= end; codepoint++) {
+        count += index_codepoint(chain, font_index, codepoint);
+    }
+    return count;
+}
+
+int font_chain_init(font_chain_t* chain) {
+    memset(chain, 0, sizeof(font_chain_t));
+    return 0;
+}
+
+int font_chain_add(font_chain_t* chain, stbtt_fontinfo* font) {
+    if (chain->count >= FONT_CHAIN_MAX) {
+        log_msg(LOG_ERROR, "Font chain is full - %d fonts", FONT_CHAIN_MAX);
+        return 1;
+    }
+    int font_index = chain->count++;
+    chain->fonts[font_index] = font;
+
+    // Read the ranges out of the cmap subtable stb_truetype chose, so only codepoints
+    // the font claims are probed, rather than all of unicode
+    const uint8_t* cmap = font->data + font->index_map;
+    uint16_t format = read_u16(cmap);
+    int count = 0;
+    if (format == 4) {
+        int segcount = read_u16(cmap + 6) / 2;
+        const uint8_t* end_codes = cmap + 14;
+        const uint8_t* start_codes = end_codes + segcount * 2 + 2;
+        for (int i = 0; i < segcount; i++) {
+            uint16_t start = read_u16(start_codes + i * 2);
+            uint16_t end = read_u16(end_codes + i * 2);
+            if (start == 0xFFFF) {
+                continue;
+            }
+            count += index_range(chain, font_index, start, end);
+        }
+    }
+    else if (format == 12 || format == 13) {
+        uint32_t ngroups = read_u32(cmap + 12);
+        for (uint32_t i = 0; i < ngroups; i++) {
+            const uint8_t* group = cmap + 16 + i * 12;
+            count += index_range(chain, font_index, read_u32(group), read_u32(group + 4));
+        }
+    }
+    else {
+        // Formats 0 and 6 only cover the basic multilingual plane
+        count += index_range(chain, font_index, 0, 0xFFFF);
+    }
+    log_msg(LOG_INFO, "Font %d in chain adds %d codepoints (cmap format %d)", font_index, count, format);
+    return 0;
+}
+
+int font_chain_lookup(font_chain_t* chain, int codepoint, stbtt_fontinfo** font, int* glyph) {
+    if (chain->count == 0) {
+        *font = NULL;
+        *glyph = 0;
+        return -1;
+    }
+    uint32_t entry = 0;
+    if (codepoint >= 0 && codepoint < CODEPOINT_MAX) {
+        uint32_t* page = chain->pages[codepoint >> COVERAGE_PAGE_BITS];
+        if (page != NULL) {
+            entry = page[codepoint & (COVERAGE_PAGE_SIZE - 1)];
+        }
+    }
+    if (entry == 0) {
+        *font = chain->fonts[0];
+        *glyph = 0;
+        return 1;
+    }
+    *font = chain->fonts[(entry >> 16) - 1];
+    *glyph = entry & 0xFFFF;
+    return 0;
+}
+
+int font_chain_layout(font_chain_t* chain, int fontsize, int x, int y, char* string, glyph_pos_t* glyphs, int max) {
+    wchar_t dst[100];
+    int size = decode_string(string, dst, 100);
+    int count = 0, height = 0, length = 0;
+    for (int i = 0; i < size && count < max; i++) {
+
+        if (dst[i] == L' ') {
+            length += fontsize / 2;
+            continue;
+        }
+        if (dst[i] == L'\n') {
+            length = 0;
+            x = x + height;
+            continue;
+        }
+        stbtt_fontinfo* font;
+        int glyph;
+        int found = font_chain_lookup(chain, dst[i], &font, &glyph);
+        if (found < 0) {
+            log_msg(LOG_ERROR, "Font chain is empty, skipping U+%04X", (unsigned)dst[i]);
+            continue;
+        }
+        if (found > 0) {
+            log_msg(LOG_WARN, "No font in chain has U+%04X", (unsigned)dst[i]);
+        }
+        glyphs[count++] = (glyph_pos_t){font, glyph, x, y + length};
+
+        // Same metrics write_glyph reports, without rasterizing
+        float scale = stbtt_ScaleForPixelHeight(font, fontsize);
+        int ix0, iy0, ix1, iy1, advanceWidth, leftSideBearing;
+        stbtt_GetGlyphBitmapBox(font, glyph, scale, scale, &ix0, &iy0, &ix1, &iy1);
+        stbtt_GetGlyphHMetrics(font, glyph, &advanceWidth, &leftSideBearing);
+        height = iy1 - iy0;
+        length += (int)(advanceWidth * scale);
+    }
+    return count;
+}
+
+int font_chain_write_string(font_chain_t* chain, int fontsize, int x, int y, char* string) {
+
+    log_msg(LOG_INFO, "Writing string: %s", string);
+    glyph_pos_t glyphs[100];
+    int count = font_chain_layout(chain, fontsize, x, y, string, glyphs, 100);
+    unsigned long heap_allocs = arena_heap_allocs();
+    int width, height;
+    for (int i = 0; i < count; i++) {
+        write_glyph(glyphs[i].font, fontsize, glyphs[i].x, glyphs[i].y, &width, &height, glyphs[i].glyph);
+    }
+    if (arena_heap_allocs() != heap_allocs) {
+        log_msg(LOG_WARN, "%lu heap allocations while writing string", arena_heap_allocs() - heap_allocs);
+    }
+    return 0;
+}
+
+int font_chain_free(font_chain_t* chain) {
+    for (int i = 0; i < COVERAGE_PAGES; i++) {
+        free(chain->pages[i]);
+        chain->pages[i] = NULL;
+    }
+    chain->count = 0;
+    return 0;
+}
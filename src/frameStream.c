@@ -0,0 +1,267 @@
+// Streams PBM or raw frames from a pipe to the e Ink display
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "stb_truetype.h"
+#include "eInkTools.h"
+#include "frameStream.h"
+#include "log.h"
+
+// A PBM the size of the panel has rows exactly as long as display ram, so it converts byte for byte
+_Static_assert((WIDTH + 7) / 8 == ROW_BYTES, "PBM rows must match display ram rows");
+
+typedef struct {
+    int fd;
+    uint8_t buffer[STREAM_BUFFER];
+    int pos;
+    int len;
+} stream_t;
+
+// Frames are read into one slot while the newest whole frame waits in the other,
+// so a frame cut off part way never overwrites the one about to be shown
+#define FRAME_BYTES (HEIGHT * ROW_BYTES > WIDTH * LANDSCAPE_ROW_BYTES ? HEIGHT * ROW_BYTES : WIDTH * LANDSCAPE_ROW_BYTES)
+static uint8_t frames[2][FRAME_BYTES];
+
+// Returns the next byte, or -1 at end of file
+static int next_byte(stream_t* s) {
+    if (s->pos == s->len) {
+        ssize_t n;
+        do {
+            n = read(s->fd, s->buffer, STREAM_BUFFER);
+        } while (n < 0 && errno == EINTR);
+        if (n < 0) {
+            log_msg(LOG_ERROR, "Failed to read frame stream");
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        s->pos = 0;
+        s->len = n;
+    }
+    return s->buffer[s->pos++];
+}
+
+// Reads length bytes to dst. Anything already buffered is used first, the rest is read straight into dst.
+// Returns 0 on success, -1 at end of file before any byte, 1 at end of file part way through.
+static int read_bytes(stream_t* s, uint8_t* dst, int length) {
+    int done = s->len - s->pos < length ? s->len - s->pos : length;
+    memcpy(dst, s->buffer + s->pos, done);
+    s->pos += done;
+    while (done < length) {
+        ssize_t n = read(s->fd, dst + done, length - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            if (n < 0) {
+                log_msg(LOG_ERROR, "Failed to read frame stream");
+            }
+            return done == 0 ? -1 : 1;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+// Whether more of the stream can be read without waiting
+static int stream_ready(stream_t* s) {
+    if (s->pos < s->len) {
+        return 1;
+    }
+    struct pollfd pfd = {s->fd, POLLIN, 0};
+    return poll(&pfd, 1, 0) > 0;
+}
+
+// Skips whitespace and comments, returning the first other byte
+static int skip_space(stream_t* s) {
+    int c = next_byte(s);
+    while (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '#') {
+        if (c == '#') {
+            while (c != '\n' && c != -1) {
+                c = next_byte(s);
+            }
+        }
+        c = next_byte(s);
+    }
+    return c;
+}
+
+// Reads a number from a PBM header, along with the single whitespace byte after it
+static int read_number(stream_t* s, int* value) {
+    int c = skip_space(s);
+    if (c < '0' || c > '9') {
+        return 1;
+    }
+    *value = 0;
+    while (c >= '0' && c <= '9') {
+        *value = *value * 10 + (c - '0');
+        c = next_byte(s);
+    }
+    return 0;
+}
+
+// Skips to just after the next "P4", to find the frame after a bad one. c is the last byte read.
+// Returns -1 at end of file.
+static int find_magic(stream_t* s, int c) {
+    while (c != -1) {
+        if (c == 'P') {
+            c = next_byte(s);
+            if (c == '4') {
+                return 0;
+            }
+        }
+        else {
+            c = next_byte(s);
+        }
+    }
+    return -1;
+}
+
+// Reads a frame into a slot.
+// Returns 0 on success, 1 for a bad frame that was skipped, -1 at end of file, whole frame or not.
+static int read_frame(stream_t* s, frame_format_t format, uint8_t* frame, int* is_landscape) {
+    int ret;
+    if (format == FRAME_RAW) {
+        ret = read_bytes(s, frame, HEIGHT * ROW_BYTES);
+        if (ret > 0) {
+            log_msg(LOG_WARN, "Stream ended part way through a frame");
+            return -1;
+        }
+        *is_landscape = 0;
+        return ret;
+    }
+
+    int c = skip_space(s);
+    if (c == -1) {
+        return -1;
+    }
+    if (c != 'P' || (c = next_byte(s)) != '4') {
+        log_msg(LOG_ERROR, "Frame is not a P4 PBM, skipping to the next P4");
+        if (find_magic(s, c) != 0) {
+            return -1;
+        }
+    }
+    int width, height;
+    if (read_number(s, &width) || read_number(s, &height)) {
+        log_msg(LOG_ERROR, "Bad PBM header");
+        return 1;
+    }
+    if (width == WIDTH && height == HEIGHT) {
+        ret = read_bytes(s, frame, HEIGHT * ROW_BYTES);
+        *is_landscape = 0;
+    }
+    else if (width == HEIGHT && height == WIDTH) {
+        ret = read_bytes(s, frame, WIDTH * LANDSCAPE_ROW_BYTES);
+        *is_landscape = 1;
+    }
+    else {
+        // The next read skips over its data to the next P4
+        log_msg(LOG_ERROR, "Frame is %dx%d, expected %dx%d or %dx%d", width, height, WIDTH, HEIGHT, HEIGHT, WIDTH);
+        return 1;
+    }
+    if (ret > 0) {
+        log_msg(LOG_WARN, "Stream ended part way through a frame");
+    }
+    if (ret != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// Copies a frame from its slot into display ram
+static int convert_frame(uint8_t* frame, uint8_t* framebuffer, frame_format_t format, int is_landscape) {
+    if (format == FRAME_RAW) {
+        memcpy(framebuffer, frame, HEIGHT * ROW_BYTES);
+        return 0;
+    }
+    if (!is_landscape) {
+        // PBM uses 1 for black, display ram 1 for white
+        for (int i = 0; i < HEIGHT * ROW_BYTES; i++) {
+            framebuffer[i] = ~frame[i];
+        }
+        return 0;
+    }
+    // Landscape rows run along y, with the top row at the largest x, the same way text is drawn
+    memset(framebuffer, 0xFF, HEIGHT * ROW_BYTES);
+    for (int row = 0; row < WIDTH; row++) {
+        int x = WIDTH - 1 - row;
+        uint8_t* src = &frame[row * LANDSCAPE_ROW_BYTES];
+        for (int y = 0; y < HEIGHT; y++) {
+            if (src[y / 8] & (1 << (7 - y % 8))) {
+                framebuffer[y * ROW_BYTES + x / 8] &= ~(1 << (7 - x % 8));
+            }
+        }
+    }
+    return 0;
+}
+
+int stream_frames(int fd, frame_format_t format) {
+    stream_t s;
+    memset(&s, 0, sizeof(stream_t));
+    s.fd = fd;
+    uint8_t* framebuffer = get_framebuffer();
+    region_t screen = {0, 0, WIDTH, HEIGHT};
+    int shown = 0, dropped = 0, bad = 0;
+    int pending = 0; // whether a whole frame is waiting in frames[slot ^ 1]
+    int slot = 0, is_landscape = 0, pending_landscape = 0;
+
+    int ret;
+    do {
+        ret = read_frame(&s, format, frames[slot], &is_landscape);
+        if (ret == 0) {
+            dropped += pending;
+            pending = 1;
+            pending_landscape = is_landscape;
+            slot ^= 1;
+        }
+        else if (ret > 0) {
+            bad++;
+        }
+
+        // The panel is slower than most producers - only show the newest frame already waiting
+        if (pending && (ret < 0 || !stream_ready(&s))) {
+            convert_frame(frames[slot ^ 1], framebuffer, format, pending_landscape);
+            if (shown % STREAM_FULL_REFRESH == STREAM_FULL_REFRESH - 1) {
+                activate_display();
+            }
+            else {
+                activate_display_regions(&screen, 1);
+            }
+            shown++;
+            pending = 0;
+        }
+    } while (ret >= 0);
+    log_msg(LOG_INFO, "Showed %d frames, dropped %d, skipped %d bad", shown, dropped, bad);
+    return bad > 0 ? 1 : 0;
+}
+
+int stream_path(char* path, frame_format_t format) {
+    if (strcmp(path, "-") == 0) {
+        return stream_frames(STDIN_FILENO, format);
+    }
+    while (1) {
+        // Opening a FIFO waits for a writer
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            log_msg(LOG_ERROR, "Failed to open %s", path);
+            exit(EXIT_FAILURE);
+        }
+        struct stat st;
+        fstat(fd, &st);
+        int ret = stream_frames(fd, format);
+        close(fd);
+        // A writer that stopped, even part way through a frame, is not the end of a FIFO
+        if (!S_ISFIFO(st.st_mode)) {
+            return ret;
+        }
+        log_msg(LOG_INFO, "Waiting for the next writer on %s", path);
+    }
+}
@@ -0,0 +1,170 @@
+// Parallel glyph rasterization for the e Ink display
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "stb_truetype.h"
+#include "arena.h"
+#include "eInkTools.h"
+#include "fontTools.h"
+#include "renderPool.h"
+#include "log.h"
+
+// Rasterizes glyphs of the current batch until there are none left
+static int rasterize_glyphs(render_pool_t* pool, int worker_index) {
+    render_worker_t* worker = &pool->workers[worker_index];
+    int i;
+    while ((i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED)) < pool->count) {
+        glyph_pos_t* pos = &pool->glyphs[i];
+        render_result_t* result = &pool->results[i];
+
+        // A copy of the font, so stb_truetype's allocations go to this thread's arena
+        stbtt_fontinfo font = *pos->font;
+        font.userdata = &worker->scratch;
+
+        // The same box and rasterizer stbtt_GetGlyphBitmap uses, with the output kept apart
+        // from the scratch memory so the scratch can be reset straight away
+        float scale = stbtt_ScaleForPixelHeight(&font, pool->fontsize);
+        int ix0, iy0, ix1, iy1;
+        stbtt_GetGlyphBitmapBox(&font, pos->glyph, scale, scale, &ix0, &iy0, &ix1, &iy1);
+        result->width = ix1 - ix0;
+        result->height = iy1 - iy0;
+        result->xoff = ix0;
+        result->yoff = iy0;
+        result->worker = worker_index;
+        result->bitmap = NULL;
+        if (result->width > 0 && result->height > 0) {
+            result->bitmap = arena_alloc(&worker->output, result->width * result->height);
+            stbtt_MakeGlyphBitmap(&font, result->bitmap, result->width, result->height, result->width,
+                                  scale, scale, pos->glyph);
+        }
+        arena_reset(&worker->scratch);
+    }
+    return 0;
+}
+
+static void* worker_main(void* arg) {
+    render_worker_t* worker = arg;
+    render_pool_t* pool = worker->pool;
+    int worker_index = worker - pool->workers;
+    unsigned generation = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        while (pool->generation == generation && !pool->stop) {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        if (pool->stop) {
+            break;
+        }
+        generation = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        rasterize_glyphs(pool, worker_index);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->running--;
+        if (pool->running == 0) {
+            pthread_cond_signal(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+int render_pool_init(render_pool_t* pool, int threads) {
+    memset(pool, 0, sizeof(render_pool_t));
+    if (threads < 1) {
+        threads = 1;
+    }
+    if (threads > RENDER_MAX_THREADS) {
+        threads = RENDER_MAX_THREADS;
+    }
+    log_msg(LOG_INFO, "Starting %d render threads", threads);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (int i = 0; i < threads; i++) {
+        render_worker_t* worker = &pool->workers[i];
+        worker->pool = pool;
+        arena_init(&worker->scratch, GLYPH_ARENA_SIZE);
+        arena_init(&worker->output, RENDER_OUTPUT_ARENA_SIZE);
+        if (pthread_create(&worker->thread, NULL, worker_main, worker) != 0) {
+            log_msg(LOG_ERROR, "Failed to start render thread");
+            exit(EXIT_FAILURE);
+        }
+        pool->threads++;
+    }
+    return 0;
+}
+
+// Rasterizes and draws up to RENDER_MAX_GLYPHS glyphs
+static int write_batch(render_pool_t* pool, glyph_pos_t* glyphs, int count, int fontsize) {
+    pthread_mutex_lock(&pool->lock);
+    pool->glyphs = glyphs;
+    pool->count = count;
+    pool->fontsize = fontsize;
+    pool->next = 0;
+    pool->running = pool->threads;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    while (pool->running > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    // Draw in layout order, as write_glyph would have
+    for (int i = 0; i < count; i++) {
+        render_result_t* result = &pool->results[i];
+        if (result->bitmap == NULL) {
+            continue;
+        }
+        write_bitmap(result->bitmap, result->width, result->height,
+                     glyphs[i].x - result->yoff, glyphs[i].y + result->xoff);
+        arena_free(&pool->workers[result->worker].output, result->bitmap);
+    }
+    for (int i = 0; i < pool->threads; i++) {
+        arena_reset(&pool->workers[i].output);
+    }
+    return 0;
+}
+
+int render_pool_write_glyphs(render_pool_t* pool, glyph_pos_t* glyphs, int count, int fontsize) {
+    unsigned long heap_allocs = arena_heap_allocs();
+    for (int start = 0; start < count; start += RENDER_MAX_GLYPHS) {
+        int batch = count - start < RENDER_MAX_GLYPHS ? count - start : RENDER_MAX_GLYPHS;
+        write_batch(pool, glyphs + start, batch, fontsize);
+    }
+    if (arena_heap_allocs() != heap_allocs) {
+        log_msg(LOG_WARN, "%lu heap allocations while writing glyphs", arena_heap_allocs() - heap_allocs);
+    }
+    return 0;
+}
+
+int render_pool_write_string(render_pool_t* pool, font_chain_t* chain, int fontsize, int x, int y, char* string) {
+    log_msg(LOG_INFO, "Writing string: %s", string);
+    glyph_pos_t glyphs[100];
+    int count = font_chain_layout(chain, fontsize, x, y, string, glyphs, 100);
+    return render_pool_write_glyphs(pool, glyphs, count, fontsize);
+}
+
+int render_pool_free(render_pool_t* pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->threads; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+        arena_destroy(&pool->workers[i].scratch);
+        arena_destroy(&pool->workers[i].output);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    pool->threads = 0;
+    return 0;
+}
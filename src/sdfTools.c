@@ -0,0 +1,179 @@
+// Signed distance field text for the e Ink display
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "stb_truetype.h"
+#include "arena.h"
+#include "eInkTools.h"
+#include "fontTools.h"
+#include "sdfTools.h"
+#include "log.h"
+
+int sdf_cache_init(sdf_cache_t* cache) {
+    memset(cache, 0, sizeof(sdf_cache_t));
+    return 0;
+}
+
+static unsigned hash_glyph(stbtt_fontinfo* font, int glyph) {
+    return (unsigned)((uintptr_t)font >> 4) * 31u + (unsigned)glyph * 2654435761u;
+}
+
+// Generates the field for a glyph at SDF_SIZE into a cache entry
+static int generate_sdf(sdf_glyph_t* entry, stbtt_fontinfo* font, int glyph) {
+    float scale = stbtt_ScaleForPixelHeight(font, SDF_SIZE);
+    int width = 0, height = 0, xoff = 0, yoff = 0;
+    unsigned char* sdf = stbtt_GetGlyphSDF(font, scale, glyph, SDF_PADDING, SDF_ONEDGE, SDF_DIST_SCALE,
+                                           &width, &height, &xoff, &yoff);
+    entry->font = font;
+    entry->glyph = glyph;
+    entry->sdf = NULL;
+    entry->width = 0;
+    entry->height = 0;
+    entry->xoff = xoff;
+    entry->yoff = yoff;
+    if (sdf != NULL) {
+        // Kept for the life of the cache, so copied out of the glyph arena
+        entry->sdf = malloc(width * height);
+        if (entry->sdf == NULL) {
+            log_msg(LOG_ERROR, "Failed to allocate distance field");
+            exit(EXIT_FAILURE);
+        }
+        memcpy(entry->sdf, sdf, width * height);
+        entry->width = width;
+        entry->height = height;
+        stbtt_FreeSDF(sdf, font->userdata);
+    }
+    arena_reset(font->userdata);
+    return 0;
+}
+
+// Finds the cached field for a glyph, generating it if it is not there
+static sdf_glyph_t* find_sdf(sdf_cache_t* cache, stbtt_fontinfo* font, int glyph) {
+    unsigned home = hash_glyph(font, glyph) & (SDF_CACHE_SIZE - 1);
+    for (int i = 0; i < SDF_CACHE_PROBES; i++) {
+        sdf_glyph_t* entry = &cache->entries[(home + i) & (SDF_CACHE_SIZE - 1)];
+        if (entry->font == font && entry->glyph == glyph) {
+            cache->hits++;
+            return entry;
+        }
+        if (entry->font == NULL) {
+            cache->misses++;
+            generate_sdf(entry, font, glyph);
+            return entry;
+        }
+    }
+    // Nowhere free nearby - replace the glyph in its home slot
+    sdf_glyph_t* entry = &cache->entries[home];
+    free(entry->sdf);
+    cache->misses++;
+    generate_sdf(entry, font, glyph);
+    return entry;
+}
+
+// Value of the field at a pixel, with everything outside the field counted as far outside the glyph
+static float texel(sdf_glyph_t* entry, int u, int v) {
+    if (u < 0 || v < 0 || u >= entry->width || v >= entry->height) {
+        return 0;
+    }
+    return entry->sdf[v * entry->width + u];
+}
+
+// Bilinear sample of the field. u v are in field pixels, with 0 0 the centre of the first pixel.
+static float sample_sdf(sdf_glyph_t* entry, float u, float v) {
+    int u0 = (int)floorf(u);
+    int v0 = (int)floorf(v);
+    float fu = u - u0;
+    float fv = v - v0;
+    float a = texel(entry, u0, v0);
+    float b = texel(entry, u0 + 1, v0);
+    float c = texel(entry, u0, v0 + 1);
+    float d = texel(entry, u0 + 1, v0 + 1);
+    return a + (b - a) * fu + (c - a) * fv + (a - b - c + d) * fu * fv;
+}
+
+// Keeps the edge weight and outline move inside the field, as sdf_max_edge describes.
+// Returns 1 if either was changed.
+static int clamp_effects(int fontsize, float* weight, float* outline) {
+    float max_edge = sdf_max_edge(fontsize);
+    int clamped = 0;
+    if (*weight > max_edge || *weight < -max_edge) {
+        *weight = *weight > 0 ? max_edge : -max_edge;
+        clamped = 1;
+    }
+    // Only the outer side of the band can run off the field. The inner side just stops at the middle of the glyph.
+    if (*outline > 0 && *weight + *outline / 2 > max_edge) {
+        *outline = 2 * (max_edge - *weight);
+        clamped = 1;
+    }
+    return clamped;
+}
+
+float sdf_max_edge(int fontsize) {
+    return (SDF_PADDING - 0.5f) * fontsize / SDF_SIZE;
+}
+
+int sdf_write_glyph(sdf_cache_t* cache, stbtt_fontinfo* fontInfo, int fontsize, int x, int y, int *width, int *height,
+                    int glyph, float weight, float outline) {
+    sdf_glyph_t* entry = find_sdf(cache, fontInfo, glyph);
+    clamp_effects(fontsize, &weight, &outline);
+
+    float ratio = (float)fontsize / SDF_SIZE;
+    float per_pixel = SDF_DIST_SCALE / ratio; // field value per pixel drawn
+    float threshold = SDF_ONEDGE - weight * per_pixel;
+    float half_band = outline * per_pixel / 2;
+
+    // The glyph's box at this size, in the same glyph coords stbtt_GetGlyphBitmap uses
+    int ox0 = (int)floorf(entry->xoff * ratio);
+    int oy0 = (int)floorf(entry->yoff * ratio);
+    int ox1 = (int)ceilf((entry->xoff + entry->width) * ratio);
+    int oy1 = (int)ceilf((entry->yoff + entry->height) * ratio);
+    for (int oy = oy0; oy < oy1 && entry->sdf != NULL; oy++) {
+        float v = (oy + 0.5f) / ratio - entry->yoff - 0.5f;
+        for (int ox = ox0; ox < ox1; ox++) {
+            float u = (ox + 0.5f) / ratio - entry->xoff - 0.5f;
+            float value = sample_sdf(entry, u, v);
+            int black = outline > 0 ? fabsf(value - threshold) <= half_band : value >= threshold;
+            if (black) {
+                // Rotated onto the display as write_bitmap does
+                write_pixel(BLACK, x - oy, y + ox);
+            }
+        }
+    }
+
+    float scale = stbtt_ScaleForPixelHeight(fontInfo, fontsize);
+    int leftSideBearing, advanceWidth;
+    stbtt_GetGlyphHMetrics(fontInfo, glyph, &advanceWidth, &leftSideBearing);
+    *width = (int)(advanceWidth * scale);
+    *height = oy1 - oy0;
+    return 0;
+}
+
+int sdf_write_string(sdf_cache_t* cache, font_chain_t* chain, int fontsize, int x, int y, char* string,
+                     float weight, float outline) {
+    log_msg(LOG_INFO, "Writing SDF string: %s", string);
+    if (clamp_effects(fontsize, &weight, &outline)) {
+        log_msg(LOG_WARN, "Weight and outline limited to %.1f pixels from the edge at size %d, drawing %.1f %.1f",
+                sdf_max_edge(fontsize), fontsize, weight, outline);
+    }
+    glyph_pos_t glyphs[100];
+    int count = font_chain_layout(chain, fontsize, x, y, string, glyphs, 100);
+    int width, height;
+    for (int i = 0; i < count; i++) {
+        sdf_write_glyph(cache, glyphs[i].font, fontsize, glyphs[i].x, glyphs[i].y, &width, &height,
+                        glyphs[i].glyph, weight, outline);
+    }
+    return 0;
+}
+
+int sdf_cache_free(sdf_cache_t* cache) {
+    for (int i = 0; i < SDF_CACHE_SIZE; i++) {
+        free(cache->entries[i].sdf);
+    }
+    log_msg(LOG_INFO, "SDF cache: %lu hits, %lu misses", cache->hits, cache->misses);
+    memset(cache, 0, sizeof(sdf_cache_t));
+    return 0;
+}
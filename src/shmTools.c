@@ -0,0 +1,165 @@
+// Shared memory framebuffer for the e Ink display, with futex commit signalling
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "stb_truetype.h"
+#include "eInkTools.h"
+#include "shmTools.h"
+#include "log.h"
+
+// Not FUTEX_PRIVATE, as the word is shared between processes
+static long futex(uint32_t* word, int op, uint32_t value, const struct timespec* timeout) {
+    return syscall(SYS_futex, word, op, value, timeout, NULL, 0);
+}
+
+// The dirty region is kept in one 64 bit word, 16 bits each for x y width height,
+// so producers can grow it with a compare and swap instead of a lock a crashed producer could leave held
+static uint64_t pack_dirty(region_t* region) {
+    return (uint64_t)(uint16_t)region->x << 48 | (uint64_t)(uint16_t)region->y << 32 |
+           (uint64_t)(uint16_t)region->width << 16 | (uint16_t)region->height;
+}
+
+static region_t unpack_dirty(uint64_t packed) {
+    return (region_t){(packed >> 48) & 0xFFFF, (packed >> 32) & 0xFFFF, (packed >> 16) & 0xFFFF, packed & 0xFFFF};
+}
+
+static shm_framebuffer_t* map_framebuffer(int fd) {
+    void* map = mmap(NULL, sizeof(shm_framebuffer_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        log_msg(LOG_ERROR, "Failed to map shared framebuffer");
+        return NULL;
+    }
+    return map;
+}
+
+shm_framebuffer_t* shm_fb_create(const char* name) {
+    log_msg(LOG_INFO, "Creating shared framebuffer %s", name);
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0666);
+    if (fd < 0) {
+        log_msg(LOG_ERROR, "Failed to create shared framebuffer %s", name);
+        exit(EXIT_FAILURE);
+    }
+    if (ftruncate(fd, sizeof(shm_framebuffer_t)) < 0) {
+        log_msg(LOG_ERROR, "Failed to size shared framebuffer");
+        exit(EXIT_FAILURE);
+    }
+    shm_framebuffer_t* fb = map_framebuffer(fd);
+    if (fb == NULL) {
+        exit(EXIT_FAILURE);
+    }
+
+    // Producers check the magic last, so it only matches once the rest is set
+    fb->magic = 0;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    fb->version = SHM_FB_VERSION;
+    fb->width = WIDTH;
+    fb->height = HEIGHT;
+    fb->row_bytes = ROW_BYTES;
+    fb->dirty = 0;
+    memset(fb->pixels, 0xFF, sizeof(fb->pixels));
+    __atomic_store_n(&fb->magic, SHM_FB_MAGIC, __ATOMIC_RELEASE);
+    return fb;
+}
+
+shm_framebuffer_t* shm_fb_open(const char* name) {
+    log_msg(LOG_INFO, "Opening shared framebuffer %s", name);
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) {
+        log_msg(LOG_ERROR, "Failed to open shared framebuffer %s", name);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(shm_framebuffer_t)) {
+        log_msg(LOG_ERROR, "Shared framebuffer %s is too small", name);
+        close(fd);
+        return NULL;
+    }
+    shm_framebuffer_t* fb = map_framebuffer(fd);
+    if (fb == NULL) {
+        return NULL;
+    }
+    if (__atomic_load_n(&fb->magic, __ATOMIC_ACQUIRE) != SHM_FB_MAGIC || fb->version != SHM_FB_VERSION ||
+        fb->width != WIDTH || fb->height != HEIGHT || fb->row_bytes != ROW_BYTES) {
+        log_msg(LOG_ERROR, "Shared framebuffer %s does not match this display", name);
+        shm_fb_close(fb);
+        return NULL;
+    }
+    return fb;
+}
+
+int shm_fb_commit(shm_framebuffer_t* fb, region_t* region) {
+    region_t screen = {0, 0, WIDTH, HEIGHT};
+    region_t changed;
+    if (region == NULL) {
+        changed = screen;
+    }
+    else if (intersect_region(region, &screen, &changed) == 0) {
+        return 0;
+    }
+
+    uint64_t old = __atomic_load_n(&fb->dirty, __ATOMIC_RELAXED);
+    uint64_t grown;
+    do {
+        region_t dirty = unpack_dirty(old);
+        if (dirty.width == 0 || dirty.height == 0) {
+            dirty = changed;
+        }
+        else {
+            // Grow to cover both
+            int x1 = dirty.x + dirty.width > changed.x + changed.width ? dirty.x + dirty.width : changed.x + changed.width;
+            int y1 = dirty.y + dirty.height > changed.y + changed.height ? dirty.y + dirty.height : changed.y + changed.height;
+            dirty.x = dirty.x < changed.x ? dirty.x : changed.x;
+            dirty.y = dirty.y < changed.y ? dirty.y : changed.y;
+            dirty.width = x1 - dirty.x;
+            dirty.height = y1 - dirty.y;
+        }
+        grown = pack_dirty(&dirty);
+        // On failure old is reloaded with what another producer stored, and the union is redone
+    } while (!__atomic_compare_exchange_n(&fb->dirty, &old, grown, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    __atomic_add_fetch(&fb->sequence, 1, __ATOMIC_RELEASE);
+    futex(&fb->sequence, FUTEX_WAKE, INT_MAX, NULL);
+    return 0;
+}
+
+int shm_fb_wait(shm_framebuffer_t* fb, uint32_t* sequence, region_t* dirty, int timeout_ms) {
+    struct timespec timeout = {timeout_ms / 1000, (timeout_ms % 1000) * 1000000L};
+    while (__atomic_load_n(&fb->sequence, __ATOMIC_ACQUIRE) == *sequence) {
+        // Sleeps only if the sequence is still *sequence, so a commit in between is not missed
+        if (futex(&fb->sequence, FUTEX_WAIT, *sequence, timeout_ms < 0 ? NULL : &timeout) < 0) {
+            if (errno == ETIMEDOUT) {
+                return 1;
+            }
+            if (errno == EINTR) {
+                return -1;
+            }
+        }
+    }
+    *sequence = __atomic_load_n(&fb->sequence, __ATOMIC_ACQUIRE);
+
+    *dirty = unpack_dirty(__atomic_exchange_n(&fb->dirty, 0, __ATOMIC_ACQUIRE));
+    return 0;
+}
+
+int shm_fb_close(shm_framebuffer_t* fb) {
+    munmap(fb, sizeof(shm_framebuffer_t));
+    return 0;
+}
+
+int shm_fb_unlink(const char* name) {
+    shm_unlink(name);
+    return 0;
+}
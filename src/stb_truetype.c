@@ -1,3 +1,9 @@
+#include "../include/arena.h"
+
+// Route stb_truetype's allocations to the arena passed as the font's userdata
+#define STBTT_malloc(x,u) arena_alloc((arena_t*)(u), (x))
+#define STBTT_free(x,u) arena_free((arena_t*)(u), (x))
+
 #define STB_TRUETYPE_IMPLEMENTATION
 
-#include "../include/stb_truetype.h"
\ No newline at end of file
+#include "../include/stb_truetype.h"
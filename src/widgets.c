@@ -0,0 +1,279 @@
+// Retained widgets for the e Ink display. Only dirty widgets are redrawn.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "stb_truetype.h"
+#include "eInkTools.h"
+#include "widgets.h"
+#include "log.h"
+
+#define MAX_DAMAGE (SCENE_MAX_WIDGETS * 2)
+
+int scene_init(scene_t* scene) {
+    memset(scene, 0, sizeof(scene_t));
+    return 0;
+}
+
+static widget_t* add_widget(scene_t* scene, widget_type_t type, region_t bounds) {
+    if (scene->count >= SCENE_MAX_WIDGETS) {
+        log_msg(LOG_ERROR, "Scene is full - %d widgets", SCENE_MAX_WIDGETS);
+        return NULL;
+    }
+    widget_t* widget = &scene->widgets[scene->count++];
+    memset(widget, 0, sizeof(widget_t));
+    widget->type = type;
+    widget->bounds = bounds;
+    widget->visible = 1;
+    widget->dirty = 1;
+    return widget;
+}
+
+// Copies a string into a text widget's buffer. A string too long for it is cut at the last
+// whole UTF-8 character, as half a character would fail to decode when the widget is drawn.
+// Returns 1 if the string was cut.
+static int copy_text(char* dst, const char* src) {
+    size_t length = strlen(src);
+    if (length >= WIDGET_TEXT_MAX) {
+        length = WIDGET_TEXT_MAX - 1;
+        // Back up to the lead byte of the character that did not fit
+        while (length > 0 && (src[length] & 0xC0) == 0x80) {
+            length--;
+        }
+    }
+    memcpy(dst, src, length);
+    dst[length] = '\0';
+    return src[length] != '\0';
+}
+
+widget_t* scene_add_text(scene_t* scene, region_t bounds, stbtt_fontinfo* font, int fontsize, const char* string) {
+    widget_t* widget = add_widget(scene, WIDGET_TEXT, bounds);
+    if (widget == NULL) {
+        return NULL;
+    }
+    widget->text.font = font;
+    widget->text.fontsize = fontsize;
+    if (copy_text(widget->text.string, string)) {
+        log_msg(LOG_WARN, "Text is longer than %d bytes, cut to \"%s\"", WIDGET_TEXT_MAX - 1, widget->text.string);
+    }
+    return widget;
+}
+
+widget_t* scene_add_rect(scene_t* scene, region_t bounds, int colour, int filled) {
+    widget_t* widget = add_widget(scene, WIDGET_RECT, bounds);
+    if (widget == NULL) {
+        return NULL;
+    }
+    widget->rect.colour = colour;
+    widget->rect.filled = filled;
+    return widget;
+}
+
+widget_t* scene_add_image(scene_t* scene, region_t bounds, const uint8_t* bitmap) {
+    widget_t* widget = add_widget(scene, WIDGET_IMAGE, bounds);
+    if (widget == NULL) {
+        return NULL;
+    }
+    widget->image.bitmap = bitmap;
+    return widget;
+}
+
+// The widget's values share a union, so setting the wrong type would corrupt them
+static int check_type(widget_t* widget, widget_type_t type) {
+    if (widget->type != type) {
+        log_msg(LOG_ERROR, "Widget is type %d, not %d", widget->type, type);
+        return 1;
+    }
+    return 0;
+}
+
+int widget_set_text(widget_t* widget, const char* string) {
+    if (check_type(widget, WIDGET_TEXT)) {
+        return 1;
+    }
+    // Compare what would be stored, so an over-long string cut the same way is no change
+    char text[WIDGET_TEXT_MAX];
+    int cut = copy_text(text, string);
+    if (strcmp(widget->text.string, text) == 0) {
+        return 0;
+    }
+    if (cut) {
+        log_msg(LOG_WARN, "Text is longer than %d bytes, cut to \"%s\"", WIDGET_TEXT_MAX - 1, text);
+    }
+    memcpy(widget->text.string, text, WIDGET_TEXT_MAX);
+    widget->dirty = 1;
+    return 0;
+}
+
+int widget_set_colour(widget_t* widget, int colour) {
+    if (check_type(widget, WIDGET_RECT)) {
+        return 1;
+    }
+    if (widget->rect.colour == colour) {
+        return 0;
+    }
+    widget->rect.colour = colour;
+    widget->dirty = 1;
+    return 0;
+}
+
+// The bitmap may have been changed in place, so this always marks the widget dirty
+int widget_set_image(widget_t* widget, const uint8_t* bitmap) {
+    if (check_type(widget, WIDGET_IMAGE)) {
+        return 1;
+    }
+    widget->image.bitmap = bitmap;
+    widget->dirty = 1;
+    return 0;
+}
+
+int widget_set_bounds(widget_t* widget, region_t bounds) {
+    if (memcmp(&widget->bounds, &bounds, sizeof(region_t)) == 0) {
+        return 0;
+    }
+    widget->bounds = bounds;
+    widget->dirty = 1;
+    return 0;
+}
+
+int widget_set_visible(widget_t* widget, int visible) {
+    if (widget->visible == visible) {
+        return 0;
+    }
+    widget->visible = visible;
+    widget->dirty = 1;
+    return 0;
+}
+
+static int draw_text(widget_t* widget) {
+    stbtt_fontinfo* font = widget->text.font;
+    float scale = stbtt_ScaleForPixelHeight(font, widget->text.fontsize);
+    int ascent, descent, lineGap;
+    stbtt_GetFontVMetrics(font, &ascent, &descent, &lineGap);
+    // Glyphs grow towards larger x from the baseline, so sit the baseline above the bottom of the bounds
+    int baseline = widget->bounds.x + (int)(-descent * scale);
+    return write_string(font, widget->text.fontsize, baseline, widget->bounds.y, widget->text.string);
+}
+
+static int draw_rect(widget_t* widget) {
+    region_t* b = &widget->bounds;
+    if (widget->rect.filled) {
+        return fill_region(widget->rect.colour, b);
+    }
+    for (int i = b->x; i < b->x + b->width; i++) {
+        write_pixel(widget->rect.colour, i, b->y);
+        write_pixel(widget->rect.colour, i, b->y + b->height - 1);
+    }
+    for (int j = b->y; j < b->y + b->height; j++) {
+        write_pixel(widget->rect.colour, b->x, j);
+        write_pixel(widget->rect.colour, b->x + b->width - 1, j);
+    }
+    return 0;
+}
+
+static int draw_image(widget_t* widget) {
+    region_t* b = &widget->bounds;
+    int stride = (b->width + 7) / 8;
+    const uint8_t* bitmap = widget->image.bitmap;
+    if (bitmap == NULL) {
+        return 1;
+    }
+    for (int j = 0; j < b->height; j++) {
+        for (int i = 0; i < b->width; i++) {
+            int bit = (bitmap[j * stride + i / 8] >> (7 - i % 8)) & 1;
+            write_pixel(bit ? WHITE : BLACK, b->x + i, b->y + j);
+        }
+    }
+    return 0;
+}
+
+static int draw_widget(widget_t* widget) {
+    switch (widget->type) {
+        case WIDGET_TEXT:  return draw_text(widget);
+        case WIDGET_RECT:  return draw_rect(widget);
+        case WIDGET_IMAGE: return draw_image(widget);
+        default:           return 1;
+    }
+}
+
+// Adds a region to the damage list, unless it is empty or already covered
+static int add_damage(region_t* damage, int count, region_t* region) {
+    region_t screen = {0, 0, WIDTH, HEIGHT};
+    region_t clipped;
+    if (intersect_region(region, &screen, &clipped) == 0) {
+        return count;
+    }
+    for (int i = 0; i < count; i++) {
+        region_t overlap;
+        if (intersect_region(&damage[i], &clipped, &overlap) &&
+            memcmp(&overlap, &clipped, sizeof(region_t)) == 0) {
+            return count;
+        }
+    }
+    damage[count] = clipped;
+    return count + 1;
+}
+
+int scene_render(scene_t* scene, region_t* regions, int max_regions) {
+    region_t damage[MAX_DAMAGE];
+    int count = 0;
+
+    // Check before anything is redrawn, or the changes would be marked done without being reported
+    if (max_regions < 1) {
+        log_msg(LOG_ERROR, "No room to report changed regions");
+        return 0;
+    }
+
+    for (int i = 0; i < scene->count; i++) {
+        widget_t* widget = &scene->widgets[i];
+        if (!widget->dirty) {
+            continue;
+        }
+        if (widget->is_drawn) {
+            count = add_damage(damage, count, &widget->drawn);
+        }
+        if (widget->visible) {
+            count = add_damage(damage, count, &widget->bounds);
+        }
+    }
+
+    // Clear each damaged region and redraw everything that shows through it, bottom to top
+    for (int d = 0; d < count; d++) {
+        fill_region(WHITE, &damage[d]);
+        for (int i = 0; i < scene->count; i++) {
+            widget_t* widget = &scene->widgets[i];
+            region_t overlap;
+            if (widget->visible && intersect_region(&widget->bounds, &damage[d], &overlap)) {
+                set_clip(&overlap);
+                draw_widget(widget);
+            }
+        }
+        set_clip(NULL);
+    }
+
+    for (int i = 0; i < scene->count; i++) {
+        widget_t* widget = &scene->widgets[i];
+        if (widget->dirty) {
+            widget->drawn = widget->bounds;
+            widget->is_drawn = widget->visible;
+            widget->dirty = 0;
+        }
+    }
+
+    if (count > max_regions) {
+        // Too many to report - send the box around all of them instead
+        int x0 = damage[0].x, y0 = damage[0].y;
+        int x1 = damage[0].x + damage[0].width, y1 = damage[0].y + damage[0].height;
+        for (int d = 1; d < count; d++) {
+            if (damage[d].x < x0) x0 = damage[d].x;
+            if (damage[d].y < y0) y0 = damage[d].y;
+            if (damage[d].x + damage[d].width > x1) x1 = damage[d].x + damage[d].width;
+            if (damage[d].y + damage[d].height > y1) y1 = damage[d].y + damage[d].height;
+        }
+        regions[0] = (region_t){x0, y0, x1 - x0, y1 - y0};
+        return 1;
+    }
+    memcpy(regions, damage, count * sizeof(region_t));
+    return count;
+}